@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+
+//Picks the render resolution and iteration cap for the next frame.
+//While the view moves it trades quality for speed to hold the frame
+//budget, and once the view settles it steps back up to full quality.
+class DynamicResolution {
+public:
+  static const int NUM_LEVELS = 3;  //Scales 1, 1/2 and 1/4
+
+  DynamicResolution(int target_fps, int max_iters) {
+    m_budget = 0.75 / double(target_fps);
+    m_max_iters = max_iters;
+    m_min_iters = std::max(max_iters / 8, 1);
+    m_iters = max_iters;
+    m_level = 0;
+    m_cost = 0.0;
+    m_changed = false;
+  }
+
+  //Feed the measured render cost of the last frame in seconds. The cost is
+  //only used while moving, so callers don't need to time settled frames.
+  void Update(double cost, bool moving) {
+    const int prev_level = m_level;
+    const int prev_iters = m_iters;
+
+    if (!moving) {
+      //Forget the cost so the next movement starts from a fresh measurement
+      m_cost = 0.0;
+
+      //Refine progressively, iterations first then resolution
+      if (m_iters < m_max_iters) {
+        m_iters = std::min(m_iters * 3 / 2 + 1, m_max_iters);
+      } else if (m_level > 0) {
+        m_level -= 1;
+      }
+    } else {
+      m_cost = (m_cost == 0.0 ? cost : m_cost*0.7 + cost*0.3);
+      if (m_cost > m_budget) {
+        //Over budget, resolution buys the most so drop it first
+        if (m_level < NUM_LEVELS - 1) {
+          m_level += 1;
+          m_cost *= 0.25;
+        } else {
+          m_iters = std::max(m_iters * 7 / 10, m_min_iters);
+        }
+      } else if (m_cost < m_budget * 0.5) {
+        //Well under budget, restore iterations then resolution if it fits
+        if (m_iters < m_max_iters) {
+          m_iters = std::min(m_iters * 5 / 4 + 1, m_max_iters);
+        } else if (m_level > 0 && m_cost * 4.0 < m_budget * 0.9) {
+          m_level -= 1;
+          m_cost *= 4.0;
+        }
+      }
+    }
+    m_changed = (m_level != prev_level || m_iters != prev_iters);
+  }
+
+  int Level() const { return m_level; }
+  int Iters() const { return m_iters; }
+  bool Changed() const { return m_changed; }
+
+protected:
+  double m_budget;
+  double m_cost;
+  int m_max_iters;
+  int m_min_iters;
+  int m_iters;
+  int m_level;
+  bool m_changed;
+};
@@ -0,0 +1,456 @@
+#include "ExportQueue.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+
+//Aim for strips of about this many bytes of raw image data
+static const int strip_bytes = 1 << 18;
+
+//Deflate parameters
+static const int window_size = 1 << 15;
+static const int hash_bits = 15;
+static const int max_chain = 32;
+static const int min_match = 3;
+static const int max_match = 258;
+
+//Deflate length and distance code tables (RFC 1951)
+static const int len_base[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int len_extra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int dist_base[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int dist_extra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+//One strip of rows, already wrapped in an IDAT chunk
+struct PngStrip {
+  std::vector<uint8_t> chunk;
+  uint32_t adler;
+  size_t raw_size;
+};
+
+struct ExportQueue::Job {
+  std::string filename;
+  int width, height;
+  int rows_per_strip;
+  std::vector<uint8_t> rgba;
+  RowSource source;
+  std::vector<PngStrip> strips;
+  std::atomic<int> remaining;
+};
+
+//Checksums
+struct CrcTable {
+  uint32_t entries[256];
+  CrcTable() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1);
+      }
+      entries[n] = c;
+    }
+  }
+};
+static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc) {
+  static const CrcTable table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+static uint32_t Adler32(const uint8_t* data, size_t size) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (size > 0) {
+    //Largest block that can't overflow before the modulo
+    const size_t n = std::min(size, size_t(5552));
+    for (size_t i = 0; i < n; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += n;
+    size -= n;
+  }
+  return (b << 16) | a;
+}
+static uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2) {
+  const uint32_t base = 65521;
+  const uint32_t rem = uint32_t(size2 % base);
+  uint32_t sum1 = adler1 & 0xFFFF;
+  uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % base);
+  sum1 += (adler2 & 0xFFFF) + base - 1;
+  sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+  if (sum1 >= base) { sum1 -= base; }
+  if (sum1 >= base) { sum1 -= base; }
+  if (sum2 >= base * 2) { sum2 -= base * 2; }
+  if (sum2 >= base) { sum2 -= base; }
+  return sum1 | (sum2 << 16);
+}
+
+//LSB-first bit packing for deflate
+struct BitWriter {
+  std::vector<uint8_t>& out;
+  uint32_t bits;
+  int count;
+
+  BitWriter(std::vector<uint8_t>& o) : out(o), bits(0), count(0) {}
+
+  void Put(uint32_t value, int n) {
+    bits |= value << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(uint8_t(bits));
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  //Huffman codes are stored most significant bit first
+  void PutCode(uint32_t code, int n) {
+    uint32_t rev = 0;
+    for (int i = 0; i < n; ++i) {
+      rev |= ((code >> i) & 1) << (n - 1 - i);
+    }
+    Put(rev, n);
+  }
+  void Align() {
+    if (count > 0) {
+      out.push_back(uint8_t(bits));
+    }
+    bits = 0;
+    count = 0;
+  }
+};
+
+//Fixed Huffman literal/length alphabet
+static void PutSymbol(BitWriter& bw, int sym) {
+  if (sym < 144) {
+    bw.PutCode(0x30 + sym, 8);
+  } else if (sym < 256) {
+    bw.PutCode(0x190 + sym - 144, 9);
+  } else if (sym < 280) {
+    bw.PutCode(sym - 256, 7);
+  } else {
+    bw.PutCode(0xC0 + sym - 280, 8);
+  }
+}
+static void PutMatch(BitWriter& bw, int len, int dist) {
+  int lc = 28;
+  while (len_base[lc] > len) { lc -= 1; }
+  PutSymbol(bw, 257 + lc);
+  bw.Put(len - len_base[lc], len_extra[lc]);
+  int dc = 29;
+  while (dist_base[dc] > dist) { dc -= 1; }
+  bw.PutCode(dc, 5);
+  bw.Put(dist - dist_base[dc], dist_extra[dc]);
+}
+
+//Compress data as one fixed Huffman block. Non-final blocks end with an
+//empty stored block so the next strip starts on a byte boundary.
+static void Deflate(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out) {
+  BitWriter bw(out);
+  bw.Put(final ? 1 : 0, 1);
+  bw.Put(1, 2);
+
+  std::vector<int> head(1 << hash_bits, -1);
+  std::vector<int> prev(window_size, -1);
+  auto hash = [&](size_t i) {
+    return int(((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << hash_bits) - 1));
+  };
+  auto insert = [&](size_t i) {
+    if (i + min_match <= size) {
+      const int h = hash(i);
+      prev[i % window_size] = head[h];
+      head[h] = int(i);
+    }
+  };
+
+  size_t i = 0;
+  while (i < size) {
+    //Find the longest match among recent positions with the same hash
+    int best_len = 0;
+    int best_dist = 0;
+    if (i + min_match <= size) {
+      const int limit = int(std::min(size - i, size_t(max_match)));
+      int cand = head[hash(i)];
+      for (int chain = 0; chain < max_chain && cand >= 0 && int(i) - cand <= window_size; ++chain) {
+        int len = 0;
+        while (len < limit && data[cand + len] == data[i + len]) { len += 1; }
+        if (len > best_len) {
+          best_len = len;
+          best_dist = int(i) - cand;
+          if (len == limit) { break; }
+        }
+        cand = prev[cand % window_size];
+      }
+    }
+
+    if (best_len >= min_match) {
+      PutMatch(bw, best_len, best_dist);
+      for (int k = 0; k < best_len; ++k) {
+        insert(i + k);
+      }
+      i += best_len;
+    } else {
+      PutSymbol(bw, data[i]);
+      insert(i);
+      i += 1;
+    }
+  }
+  PutSymbol(bw, 256);
+
+  if (!final) {
+    bw.Put(0, 3);
+    bw.Align();
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0xFF);
+    out.push_back(0xFF);
+  } else {
+    bw.Align();
+  }
+}
+
+//Filter rows with whichever PNG filter gives the smallest sum of residuals.
+//up is the row above the first one, or null for the top of the image. If
+//the row above exists but isn't available, first_filters is 2 so the first
+//row only tries the filters that don't look at it.
+static void FilterRows(int width, const uint8_t* rows, int num_rows, const uint8_t* up, int first_filters,
+                       std::vector<uint8_t>& raw) {
+  const int stride = width * 4;
+  std::vector<uint8_t> trial[5];
+  for (int f = 0; f < 5; ++f) {
+    trial[f].resize(stride);
+  }
+  raw.clear();
+  raw.reserve(size_t(num_rows) * (stride + 1));
+  for (int y = 0; y < num_rows; ++y) {
+    const uint8_t* cur = rows + size_t(y) * stride;
+    const int num_filters = (y == 0 ? first_filters : 5);
+    int best = 0;
+    long best_sum = -1;
+    for (int f = 0; f < num_filters; ++f) {
+      long sum = 0;
+      for (int x = 0; x < stride; ++x) {
+        const int a = (x >= 4 ? cur[x - 4] : 0);
+        const int b = (up ? up[x] : 0);
+        const int c = (up && x >= 4 ? up[x - 4] : 0);
+        int pred = 0;
+        if (f == 1) {
+          pred = a;
+        } else if (f == 2) {
+          pred = b;
+        } else if (f == 3) {
+          pred = (a + b) / 2;
+        } else if (f == 4) {
+          const int p = a + b - c;
+          const int pa = std::abs(p - a);
+          const int pb = std::abs(p - b);
+          const int pc = std::abs(p - c);
+          pred = (pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+        }
+        const uint8_t r = uint8_t(cur[x] - pred);
+        trial[f][x] = r;
+        sum += (r < 128 ? r : 256 - r);
+      }
+      if (best_sum < 0 || sum < best_sum) {
+        best = f;
+        best_sum = sum;
+      }
+    }
+    raw.push_back(uint8_t(best));
+    raw.insert(raw.end(), trial[best].begin(), trial[best].end());
+    up = cur;
+  }
+}
+
+static void AppendU32(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(uint8_t(v >> 24));
+  out.push_back(uint8_t(v >> 16));
+  out.push_back(uint8_t(v >> 8));
+  out.push_back(uint8_t(v));
+}
+static void AppendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+  AppendU32(out, uint32_t(size));
+  const size_t type_pos = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+  AppendU32(out, Crc32(&out[type_pos], size + 4, 0));
+}
+
+//rows holds image rows [row_begin, row_end), the other arguments are as in FilterRows
+static void EncodeStrip(int width, int height, const uint8_t* rows, int row_begin, int row_end,
+                        const uint8_t* up, int first_filters, PngStrip& strip) {
+  std::vector<uint8_t> raw;
+  FilterRows(width, rows, row_end - row_begin, up, first_filters, raw);
+  strip.adler = Adler32(raw.data(), raw.size());
+  strip.raw_size = raw.size();
+
+  //The first strip carries the zlib header
+  std::vector<uint8_t> data;
+  if (row_begin == 0) {
+    data.push_back(0x78);
+    data.push_back(0x01);
+  }
+  Deflate(raw.data(), raw.size(), row_end == height, data);
+  strip.chunk.clear();
+  AppendChunk(strip.chunk, "IDAT", data.data(), data.size());
+}
+
+static void AssemblePng(int width, int height, const std::vector<PngStrip>& strips, std::vector<uint8_t>& png) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+  png.assign(signature, signature + 8);
+
+  std::vector<uint8_t> ihdr;
+  AppendU32(ihdr, uint32_t(width));
+  AppendU32(ihdr, uint32_t(height));
+  ihdr.push_back(8);  //Bit depth
+  ihdr.push_back(6);  //RGBA
+  ihdr.push_back(0);
+  ihdr.push_back(0);
+  ihdr.push_back(0);
+  AppendChunk(png, "IHDR", ihdr.data(), ihdr.size());
+
+  uint32_t adler = 1;
+  for (const PngStrip& strip : strips) {
+    png.insert(png.end(), strip.chunk.begin(), strip.chunk.end());
+    adler = Adler32Combine(adler, strip.adler, strip.raw_size);
+  }
+
+  //The zlib trailer goes in one last small IDAT
+  std::vector<uint8_t> trailer;
+  AppendU32(trailer, adler);
+  AppendChunk(png, "IDAT", trailer.data(), trailer.size());
+  AppendChunk(png, "IEND", nullptr, 0);
+}
+
+static int RowsPerStrip(int width, int height) {
+  return std::min(std::max(strip_bytes / (width * 4 + 1), 1), height);
+}
+
+ExportQueue::ExportQueue(int num_threads) {
+  m_quit = false;
+  m_pending = 0;
+
+  //Leave a core for the render and audio threads by default
+  if (num_threads <= 0) {
+    num_threads = std::max(int(std::thread::hardware_concurrency()) - 1, 1);
+  }
+  for (int t = 0; t < num_threads; ++t) {
+    m_threads.emplace_back(&ExportQueue::WorkerLoop, this);
+  }
+}
+
+ExportQueue::~ExportQueue() {
+  //Finish everything that was submitted before shutting down
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_cv.notify_all();
+  for (std::thread& t : m_threads) {
+    t.join();
+  }
+}
+
+void ExportQueue::SavePng(const std::string& filename, int width, int height, std::vector<uint8_t>&& rgba) {
+  if (width <= 0 || height <= 0 || rgba.size() < size_t(width) * height * 4) {
+    std::cerr << "Invalid image for " << filename << std::endl;
+    return;
+  }
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->filename = filename;
+  job->width = width;
+  job->height = height;
+  job->rows_per_strip = RowsPerStrip(width, height);
+  job->rgba = std::move(rgba);
+  Submit(job);
+}
+
+void ExportQueue::SavePng(const std::string& filename, int width, int height, int rows_per_strip, RowSource source) {
+  if (width <= 0 || height <= 0 || rows_per_strip <= 0 || !source) {
+    std::cerr << "Invalid image for " << filename << std::endl;
+    return;
+  }
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->filename = filename;
+  job->width = width;
+  job->height = height;
+  job->rows_per_strip = std::min(rows_per_strip, height);
+  job->source = std::move(source);
+  Submit(job);
+}
+
+void ExportQueue::Submit(const std::shared_ptr<Job>& job) {
+  job->strips.resize((job->height + job->rows_per_strip - 1) / job->rows_per_strip);
+  job->remaining = int(job->strips.size());
+  m_pending += 1;
+
+  //Whichever strip finishes last writes the file
+  for (int s = 0; s < int(job->strips.size()); ++s) {
+    Push([this, job, s]() {
+      const int row_begin = s * job->rows_per_strip;
+      const int row_end = std::min(row_begin + job->rows_per_strip, job->height);
+      const size_t stride = size_t(job->width) * 4;
+      if (job->source) {
+        //Only this strip's rows exist, so the row above can't be referenced
+        std::vector<uint8_t> rows(stride * (row_end - row_begin));
+        job->source(rows.data(), row_begin, row_end);
+        EncodeStrip(job->width, job->height, rows.data(), row_begin, row_end,
+                    nullptr, (row_begin == 0 ? 5 : 2), job->strips[s]);
+      } else {
+        const uint8_t* rows = job->rgba.data() + stride * row_begin;
+        EncodeStrip(job->width, job->height, rows, row_begin, row_end,
+                    (row_begin > 0 ? rows - stride : nullptr), 5, job->strips[s]);
+      }
+      if (--job->remaining == 0) {
+        WriteJob(*job);
+        m_pending -= 1;
+      }
+    });
+  }
+}
+
+void ExportQueue::WriteJob(const Job& job) {
+  std::vector<uint8_t> png;
+  AssemblePng(job.width, job.height, job.strips, png);
+  std::ofstream fout(job.filename, std::ios::binary);
+  fout.write((const char*)png.data(), png.size());
+  if (!fout) {
+    std::cerr << "Failed to write " << job.filename << std::endl;
+  }
+}
+
+void ExportQueue::Push(std::function<void()> task) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_cv.notify_one();
+}
+
+void ExportQueue::WorkerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]() { return m_quit || !m_tasks.empty(); });
+      if (m_tasks.empty()) {
+        return;
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
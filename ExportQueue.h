@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+//Background PNG export.
+//Each image is split into strips of rows that are filtered and deflated
+//in parallel on a worker pool. Every strip becomes its own IDAT chunk, so
+//the strips are simply concatenated into one valid PNG by whichever
+//worker finishes last. Submitting never blocks the caller.
+class ExportQueue {
+public:
+  //Writes RGBA rows [row_begin, row_end) tightly packed into rgba
+  typedef std::function<void(uint8_t* rgba, int row_begin, int row_end)> RowSource;
+
+  ExportQueue(int num_threads = 0);
+  ~ExportQueue();
+
+  //Takes ownership of the RGBA pixels, rows top to bottom
+  void SavePng(const std::string& filename, int width, int height, std::vector<uint8_t>&& rgba);
+
+  //Produces the pixels on the workers too, one strip at a time, so the
+  //whole image is never held in memory. The source is called from several
+  //workers at once with disjoint rows.
+  void SavePng(const std::string& filename, int width, int height, int rows_per_strip, RowSource source);
+
+  //Exports submitted but not yet written to disk
+  int Pending() const { return m_pending; }
+
+protected:
+  struct Job;
+
+  void Submit(const std::shared_ptr<Job>& job);
+  void Push(std::function<void()> task);
+  void WorkerLoop();
+  static void WriteJob(const Job& job);
+
+  std::vector<std::thread> m_threads;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_quit;
+  std::atomic<int> m_pending;
+};
@@ -0,0 +1,218 @@
+#include "FractalSound.h"
+#include "Fractals.h"
+#include "Orbit.h"
+#include "Shading.h"
+#include <new>
+#include <algorithm>
+#include <math.h>
+
+struct fse_context {
+  //Fractal and view
+  Fractal fractal;
+  double cam_x, cam_y, cam_zoom;
+  double jx, jy;
+  bool use_color;
+
+  //Synth
+  int sample_rate;
+  int max_freq;
+  bool normalized;
+  bool sustain;
+  bool audio_reset;
+  bool audio_pause;
+  double play_nx, play_ny;
+  int32_t audio_time;
+  Orbit orbit;
+};
+
+fse_context* fse_create(int sample_rate, int max_freq) {
+  if (sample_rate <= 0 || max_freq <= 0 || max_freq > sample_rate) {
+    return nullptr;
+  }
+  fse_context* ctx = new (std::nothrow) fse_context;
+  if (ctx == nullptr) {
+    return nullptr;
+  }
+  ctx->cam_x = 0.0;
+  ctx->cam_y = 0.0;
+  ctx->cam_zoom = 100.0;
+  ctx->jx = 1e8;
+  ctx->jy = 1e8;
+  ctx->use_color = false;
+  ctx->sample_rate = sample_rate;
+  ctx->max_freq = max_freq;
+  ctx->sustain = true;
+  ctx->audio_reset = true;
+  ctx->audio_pause = true;
+  ctx->play_nx = 0.0;
+  ctx->play_ny = 0.0;
+  ctx->audio_time = 0;
+  ctx->orbit.Reset(0.0, 0.0, 0.0, 0.0);
+  fse_set_fractal(ctx, 0);
+  return ctx;
+}
+
+void fse_destroy(fse_context* ctx) {
+  delete ctx;
+}
+
+int fse_num_fractals(void) {
+  return num_fractals;
+}
+
+int fse_set_fractal(fse_context* ctx, int type) {
+  if (type < 0 || type >= num_fractals) {
+    return FSE_ERROR_ARGUMENT;
+  }
+  ctx->fractal = all_fractals[type];
+  ctx->normalized = (type == 0);
+  ctx->jx = ctx->jy = 1e8;
+  ctx->audio_pause = true;
+  return FSE_OK;
+}
+
+void fse_set_camera(fse_context* ctx, double cam_x, double cam_y, double zoom) {
+  ctx->cam_x = cam_x;
+  ctx->cam_y = cam_y;
+  ctx->cam_zoom = zoom;
+}
+
+void fse_set_julia(fse_context* ctx, double jx, double jy) {
+  ctx->jx = jx;
+  ctx->jy = jy;
+}
+
+void fse_clear_julia(fse_context* ctx) {
+  ctx->jx = ctx->jy = 1e8;
+}
+
+void fse_set_color(fse_context* ctx, int use_color) {
+  ctx->use_color = (use_color != 0);
+}
+
+void fse_set_sustain(fse_context* ctx, int sustain) {
+  ctx->sustain = (sustain != 0);
+}
+
+void fse_screen_to_pt(const fse_context* ctx, int width, int height, double sx, double sy, double* px, double* py) {
+  *px = (sx - width * 0.5) / ctx->cam_zoom - ctx->cam_x;
+  *py = (sy - height * 0.5) / ctx->cam_zoom - ctx->cam_y;
+}
+
+int fse_orbit(const fse_context* ctx, double x, double y, double* xy, int max_points) {
+  if (xy == nullptr || max_points < 0) {
+    return FSE_ERROR_ARGUMENT;
+  }
+  const double cx = (ctx->jx < 1e8 ? ctx->jx : x);
+  const double cy = (ctx->jy < 1e8 ? ctx->jy : y);
+  for (int i = 0; i < max_points; ++i) {
+    ctx->fractal(x, y, cx, cy);
+    if (x*x + y*y > escape_radius_sq) {
+      return i;
+    }
+    xy[i*2] = x;
+    xy[i*2 + 1] = y;
+  }
+  return max_points;
+}
+
+//CPU version of fractal() in frag.glsl
+static void ShadePoint(const fse_context* ctx, double x, double y, double cx, double cy, int max_iters, uint8_t* px_out) {
+  double px = x;
+  double py = y;
+  double sum_x = 0.0;
+  double sum_y = 0.0;
+  double sum_z = 0.0;
+  int i;
+  for (i = 0; i < max_iters; ++i) {
+    const double ppx = px;
+    const double ppy = py;
+    px = x;
+    py = y;
+    ctx->fractal(x, y, cx, cy);
+    if (x*x + y*y > escape_radius_sq) { break; }
+    sum_x += (x - px)*(px - ppx) + (y - py)*(py - ppy);
+    sum_y += (x - px)*(x - px) + (y - py)*(y - py);
+    sum_z += (x - ppx)*(x - ppx) + (y - ppy)*(y - ppy);
+  }
+  ShadeRGBA(i, max_iters, sum_x, sum_y, sum_z, ctx->use_color, px_out);
+}
+
+int fse_render(const fse_context* ctx, uint8_t* rgba, int width, int height, int stride, int max_iters) {
+  return fse_render_rows(ctx, rgba, width, height, stride, max_iters, 0, height);
+}
+
+int fse_render_rows(const fse_context* ctx, uint8_t* rgba, int width, int height, int stride, int max_iters,
+                    int row_begin, int row_end) {
+  if (rgba == nullptr || width <= 0 || height <= 0 || stride < width * 4 || max_iters <= 0 ||
+      row_begin < 0 || row_end > height || row_begin > row_end) {
+    return FSE_ERROR_ARGUMENT;
+  }
+  const bool has_julia = (ctx->jx < 1e8);
+  for (int sy = row_begin; sy < row_end; ++sy) {
+    uint8_t* row = rgba + size_t(sy) * stride;
+    for (int sx = 0; sx < width; ++sx) {
+      //Sample pixel centers like gl_FragCoord does
+      double x, y;
+      fse_screen_to_pt(ctx, width, height, sx + 0.5, sy + 0.5, &x, &y);
+      ShadePoint(ctx, x, y, (has_julia ? ctx->jx : x), (has_julia ? ctx->jy : y), max_iters, row + sx*4);
+    }
+  }
+  return FSE_OK;
+}
+
+void fse_synth_set_point(fse_context* ctx, double x, double y) {
+  ctx->play_nx = x;
+  ctx->play_ny = y;
+  ctx->audio_reset = true;
+  ctx->audio_pause = false;
+}
+
+void fse_synth_stop(fse_context* ctx) {
+  ctx->audio_pause = true;
+}
+
+int fse_synth_generate(fse_context* ctx, int16_t* pcm, int num_frames) {
+  if (pcm == nullptr || num_frames < 0) {
+    return FSE_ERROR_ARGUMENT;
+  }
+  std::fill(pcm, pcm + num_frames * 2, int16_t(0));
+
+  //Check if audio needs to reset
+  if (ctx->audio_reset) {
+    ctx->audio_time = 0;
+    ctx->orbit.Reset(ctx->play_nx, ctx->play_ny,
+                     (ctx->jx < 1e8 ? ctx->jx : ctx->play_nx),
+                     (ctx->jy < 1e8 ? ctx->jy : ctx->play_ny));
+    ctx->audio_reset = false;
+  }
+
+  //Check if paused
+  if (ctx->audio_pause) {
+    return 0;
+  }
+
+  //Generate the tones
+  const int steps = ctx->sample_rate / ctx->max_freq;
+  for (int i = 0; i < num_frames; ++i) {
+    const int j = ctx->audio_time % steps;
+    if (j == 0) {
+      if (!ctx->orbit.Step(ctx->fractal, ctx->normalized, ctx->sustain)) {
+        ctx->audio_pause = true;
+        return i;
+      }
+    }
+
+    //Cosine interpolation
+    double t = double(j) / double(steps);
+    t = 0.5 - 0.5*std::cos(t * 3.14159);
+    double wx, wy;
+    ctx->orbit.Sample(t, wx, wy);
+
+    //Save the audio to the 2 channels
+    pcm[i*2]     = (int16_t)std::min(std::max(wx, -32000.0), 32000.0);
+    pcm[i*2 + 1] = (int16_t)std::min(std::max(wy, -32000.0), 32000.0);
+    ctx->audio_time += 1;
+  }
+  return num_frames;
+}
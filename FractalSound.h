@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+
+//Embeddable C API for fractal evaluation, CPU rendering and orbit synthesis.
+//All state lives in an fse_context so independent sessions can run on
+//different threads. A single context must not be used by two threads at
+//once, except for fse_render_rows calls on disjoint rows which only read it.
+//In particular an audio callback running fse_synth_generate needs a lock
+//shared with whichever thread calls the setters on the same context.
+//Render and synth calls write straight into caller buffers and never allocate.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fse_context fse_context;
+
+enum {
+  FSE_OK = 0,
+  FSE_ERROR_ARGUMENT = -1,
+};
+
+//Create a session. Returns NULL if out of memory, or unless
+//0 < max_freq <= sample_rate.
+fse_context* fse_create(int sample_rate, int max_freq);
+void fse_destroy(fse_context* ctx);
+
+//Fractal selection, type is an index in [0, fse_num_fractals()).
+//Changing the fractal also clears the Julia point and stops the synth.
+int fse_num_fractals(void);
+int fse_set_fractal(fse_context* ctx, int type);
+
+//View and display options, the camera matches the interactive explorer
+void fse_set_camera(fse_context* ctx, double cam_x, double cam_y, double zoom);
+void fse_set_julia(fse_context* ctx, double jx, double jy);
+void fse_clear_julia(fse_context* ctx);
+void fse_set_color(fse_context* ctx, int use_color);
+void fse_set_sustain(fse_context* ctx, int sustain);
+
+//Convert a pixel of a width x height image to a point in the plane
+void fse_screen_to_pt(const fse_context* ctx, int width, int height, double sx, double sy, double* px, double* py);
+
+//Write up to max_points (x,y) pairs of the orbit starting at (x,y).
+//Returns the number of points written, fewer if the orbit escapes.
+int fse_orbit(const fse_context* ctx, double x, double y, double* xy, int max_points);
+
+//Render RGBA8 pixels, stride is in bytes between rows
+int fse_render(const fse_context* ctx, uint8_t* rgba, int width, int height, int stride, int max_iters);
+int fse_render_rows(const fse_context* ctx, uint8_t* rgba, int width, int height, int stride, int max_iters,
+                    int row_begin, int row_end);
+
+//Start playing the orbit of a point, or stop the sound
+void fse_synth_set_point(fse_context* ctx, double x, double y);
+void fse_synth_stop(fse_context* ctx);
+
+//Fill num_frames interleaved stereo frames. Returns the number of frames
+//that carry sound, the rest are zero because the orbit escaped or stopped.
+int fse_synth_generate(fse_context* ctx, int16_t* pcm, int num_frames);
+
+#ifdef __cplusplus
+}
+#endif
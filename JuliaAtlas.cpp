@@ -0,0 +1,133 @@
+#include "JuliaAtlas.h"
+#include "Fractals.h"
+#include "Shading.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+//Iterates one z for ATLAS_LANES values of c, freezing escaped lanes.
+//Simd is false for maps that can't vectorize, which skip escaped lanes instead.
+template<void (*F)(double&, double&, double, double), bool Simd>
+static void IterateLanes(double zx, double zy, const double* cx, const double* cy, int max_iters,
+                         int* iters, double* sum_x, double* sum_y, double* sum_z) {
+  double x[ATLAS_LANES], y[ATLAS_LANES];
+  double px[ATLAS_LANES], py[ATLAS_LANES];
+  double acc_x[ATLAS_LANES], acc_y[ATLAS_LANES], acc_z[ATLAS_LANES];
+  double count[ATLAS_LANES];
+  double live[ATLAS_LANES];
+  for (int l = 0; l < ATLAS_LANES; ++l) {
+    x[l] = px[l] = zx;
+    y[l] = py[l] = zy;
+    count[l] = 0.0;
+    acc_x[l] = acc_y[l] = acc_z[l] = 0.0;
+    live[l] = 1.0;
+  }
+
+  for (int i = 0; i < max_iters; ++i) {
+    double num_live = 0.0;
+    for (int l = 0; l < ATLAS_LANES; ++l) {
+      if (!Simd && live[l] == 0.0) { continue; }
+      double nx = x[l];
+      double ny = y[l];
+      F(nx, ny, cx[l], cy[l]);
+      const double m = (nx*nx + ny*ny <= escape_radius_sq ? live[l] : 0.0);
+      acc_x[l] += m * ((nx - x[l])*(x[l] - px[l]) + (ny - y[l])*(y[l] - py[l]));
+      acc_y[l] += m * ((nx - x[l])*(nx - x[l]) + (ny - y[l])*(ny - y[l]));
+      acc_z[l] += m * ((nx - px[l])*(nx - px[l]) + (ny - py[l])*(ny - py[l]));
+      count[l] += m;
+      const bool keep = (m != 0.0);
+      px[l] = (keep ? x[l] : px[l]);
+      py[l] = (keep ? y[l] : py[l]);
+      x[l] = (keep ? nx : x[l]);
+      y[l] = (keep ? ny : y[l]);
+      live[l] = m;
+      num_live += m;
+    }
+    if (num_live == 0.0) { break; }
+  }
+
+  for (int l = 0; l < ATLAS_LANES; ++l) {
+    iters[l] = int(count[l]);
+    sum_x[l] = acc_x[l];
+    sum_y[l] = acc_y[l];
+    sum_z[l] = acc_z[l];
+  }
+}
+
+//Lane kernels in the same order as all_fractals
+typedef void (*LaneKernel)(double, double, const double*, const double*, int, int*, double*, double*, double*);
+static const LaneKernel lane_kernels[] = {
+  IterateLanes<mandelbrot, true>,
+  IterateLanes<burning_ship, true>,
+  IterateLanes<feather, false>,
+  IterateLanes<sfx, false>,
+  IterateLanes<henon, true>,
+  IterateLanes<duffing, true>,
+  IterateLanes<ikeda, false>,
+  IterateLanes<chirikov, false>,
+};
+static_assert(sizeof(lane_kernels) / sizeof(lane_kernels[0]) == num_fractals, "Missing lane kernel");
+
+void RenderJuliaAtlas(const AtlasParams& params, uint8_t* rgba, int stride, int row_begin, int row_end) {
+  if (params.type < 0 || params.type >= num_fractals || row_begin >= row_end) {
+    return;
+  }
+  const LaneKernel kernel = lane_kernels[params.type];
+  const int tile = params.tile_size;
+  const double cell_w = (params.c_x1 - params.c_x0) / params.cols;
+  const double cell_h = (params.c_y1 - params.c_y0) / params.rows;
+  const double pixel = 2.0 * params.view_radius / tile;
+
+  //Work items are groups of ATLAS_LANES neighbouring tiles in one tile row
+  const int groups_per_row = (params.cols + ATLAS_LANES - 1) / ATLAS_LANES;
+  const int num_groups = groups_per_row * (row_end - row_begin);
+  std::atomic<int> next_group(0);
+
+  auto worker = [&]() {
+    double cx[ATLAS_LANES], cy[ATLAS_LANES];
+    double sum_x[ATLAS_LANES], sum_y[ATLAS_LANES], sum_z[ATLAS_LANES];
+    int iters[ATLAS_LANES];
+    for (;;) {
+      const int group = next_group++;
+      if (group >= num_groups) { break; }
+      const int tile_row = row_begin + group / groups_per_row;
+      const int col_begin = (group % groups_per_row) * ATLAS_LANES;
+      const int count = std::min(ATLAS_LANES, params.cols - col_begin);
+
+      //Pad the last group by repeating its final c, the extra lanes are not written
+      for (int l = 0; l < ATLAS_LANES; ++l) {
+        const int col = col_begin + std::min(l, count - 1);
+        cx[l] = params.c_x0 + (col + 0.5) * cell_w;
+        cy[l] = params.c_y0 + (tile_row + 0.5) * cell_h;
+      }
+
+      for (int v = 0; v < tile; ++v) {
+        const double zy = -params.view_radius + (v + 0.5) * pixel;
+        uint8_t* row = rgba + size_t((tile_row - row_begin) * tile + v) * stride;
+        for (int u = 0; u < tile; ++u) {
+          const double zx = -params.view_radius + (u + 0.5) * pixel;
+          kernel(zx, zy, cx, cy, params.max_iters, iters, sum_x, sum_y, sum_z);
+          for (int l = 0; l < count; ++l) {
+            uint8_t* px = row + size_t((col_begin + l) * tile + u) * 4;
+            ShadeRGBA(iters[l], params.max_iters, sum_x[l], sum_y[l], sum_z[l], params.use_color, px);
+          }
+        }
+      }
+    }
+  };
+
+  int num_threads = params.num_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(int(std::thread::hardware_concurrency()), 1);
+  }
+  num_threads = std::min(num_threads, num_groups);
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& t : threads) {
+    t.join();
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+//Grid of Julia set thumbnails across a region of the parameter plane.
+//Tile (i,j) uses c at the center of cell (i,j) of the region, and shows
+//the z plane within view_radius of the origin with the explorer's palette.
+struct AtlasParams {
+  int type;  //Index in all_fractals
+  double c_x0, c_y0;
+  double c_x1, c_y1;
+  int cols, rows;
+  int tile_size;
+  double view_radius;
+  int max_iters;
+  bool use_color;
+  int num_threads;  //0 uses all hardware threads
+};
+
+//Number of neighbouring tiles iterated together, one c per SIMD lane
+static const int ATLAS_LANES = 8;
+
+inline int AtlasWidth(const AtlasParams& params) { return params.cols * params.tile_size; }
+inline int AtlasHeight(const AtlasParams& params) { return params.rows * params.tile_size; }
+
+//Render tile rows [row_begin, row_end) as RGBA8. The first pixel row of
+//tile row row_begin goes to the start of rgba, so a large atlas can be
+//streamed out in bands. stride is in bytes between pixel rows.
+void RenderJuliaAtlas(const AtlasParams& params, uint8_t* rgba, int stride, int row_begin, int row_end);
@@ -1,12 +1,24 @@
 #define _USE_MATH_DEFINES
 #define _CRT_SECURE_NO_WARNINGS
 #include "WinAudio.h"
+#include "Fractals.h"
+#include "FractalSound.h"
+#include "OrbitSpectrum.h"
+#include "OrbitDensity.h"
+#include "DynamicResolution.h"
+#include "ExportQueue.h"
+#include "JuliaAtlas.h"
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <iostream>
 #include <complex>
 #include <math.h>
 #include <fstream>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
 
 //Constants
 static const int target_fps = 60;
@@ -16,7 +28,14 @@ static const int window_w_init = 1280;
 static const int window_h_init = 720;
 static const int starting_fractal = 0;
 static const int max_iters = 1200;
-static const double escape_radius_sq = 1000.0;
+static const int spectrum_res = 512;
+static const int spectrum_fft_size = 2048;
+static const double density_sample_radius = 4.0;
+static const int density_skip_iters = 16;
+static const int atlas_cols = 32;
+static const int atlas_tile_size = 64;
+static const int atlas_max_iters = 256;
+static const double atlas_view_radius = 2.0;
 static const char window_name[] = "Fractal Sound Explorer";
 
 //Settings
@@ -34,13 +53,18 @@ static bool sustain = true;
 static bool normalized = true;
 static bool use_color = false;
 static bool hide_orbit = true;
+static bool show_spectrum = false;
+static SpectrumMetric spectrum_metric = SPECTRUM_DOMINANT;
+static bool show_density = false;
+static DensityMode density_mode = DENSITY_ESCAPING;
+static int density_samples = 10000;
 static double jx = 1e8;
 static double jy = 1e8;
 static int frame = 0;
 
-//Fractal abstraction definition
-typedef void (*Fractal)(double&, double&, double, double);
+//Active fractal equation
 static Fractal fractal = nullptr;
+static int fractal_type = starting_fractal;
 
 //Blend modes
 const sf::BlendMode BlendAlpha(sf::BlendMode::SrcAlpha, sf::BlendMode::OneMinusSrcAlpha, sf::BlendMode::Add,
@@ -58,211 +82,59 @@ void PtToScreen(double px, double py, int& x, int& y) {
   y = int(cam_zoom * (py + cam_y)) + window_h / 2;
 }
 
-//All fractal equations
-void mandelbrot(double& x, double& y, double cx, double cy) {
-  double nx = x*x - y*y + cx;
-  double ny = 2.0*x*y + cy;
-  x = nx;
-  y = ny;
-}
-void burning_ship(double& x, double& y, double cx, double cy) {
-  double nx = x*x - y*y + cx;
-  double ny = 2.0*std::abs(x*y) + cy;
-  x = nx;
-  y = ny;
-}
-void feather(double& x, double& y, double cx, double cy) {
-  std::complex<double> z(x, y);
-  std::complex<double> z2(x*x, y*y);
-  std::complex<double> c(cx, cy);
-  std::complex<double> one(1.0, 0.0);
-  z = z*z*z/(one + z2) + c;
-  x = z.real();
-  y = z.imag();
-}
-void sfx(double& x, double& y, double cx, double cy) {
-  std::complex<double> z(x, y);
-  std::complex<double> c2(cx*cx, cy*cy);
-  z = z * (x*x + y*y) - (z * c2);
-  x = z.real();
-  y = z.imag();
-}
-void henon(double& x, double& y, double cx, double cy) {
-  double nx = 1.0 - cx*x*x + y;
-  double ny = cy*x;
-  x = nx;
-  y = ny;
-}
-void duffing(double& x, double& y, double cx, double cy) {
-  double nx = y;
-  double ny = -cy*x + cx*y - y*y*y;
-  x = nx;
-  y = ny;
-}
-void ikeda(double& x, double& y, double cx, double cy) {
-  double t = 0.4 - 6.0 / (1.0 + x*x + y*y);
-  double st = std::sin(t);
-  double ct = std::cos(t);
-  double nx = 1.0 + cx*(x*ct - y*st);
-  double ny = cy*(x*st + y*ct);
-  x = nx;
-  y = ny;
-}
-void chirikov(double& x, double& y, double cx, double cy) {
-  y += cy*std::sin(x);
-  x += cx*y;
-}
-
-//List of fractal equations
-static const Fractal all_fractals[] = {
-  mandelbrot,
-  burning_ship,
-  feather,
-  sfx,
-  henon,
-  duffing,
-  ikeda,
-  chirikov,
-};
-
 //Synthesizer class to inherit Windows Audio.
+//The orbit synthesis itself runs in a library context. The audio callback
+//generates on its own thread, so every use of the context is locked.
 class Synth : public WinAudio {
 public:
-  bool audio_reset;
-  bool audio_pause;
-  double volume;
-  double play_x, play_y;
-  double play_cx, play_cy;
-  double play_nx, play_ny;
-  double play_px, play_py;
-
   Synth(HWND hwnd) : WinAudio(hwnd, sample_rate) {
-    audio_reset = true;
-    audio_pause = false;
-    volume = 8000.0;
-    play_x = 0.0;
-    play_y = 0.0;
-    play_cx = 0.0;
-    play_cy = 0.0;
-    play_nx = 0.0;
-    play_ny = 0.0;
-    play_px = 0.0;
-    play_py = 0.0;
+    m_ctx = fse_create(sample_rate, max_freq);
+  }
+  ~Synth() {
+    stop();
+    fse_destroy(m_ctx);
   }
 
   void SetPoint(double x, double y) {
-    play_nx = x;
-    play_ny = y;
-    audio_reset = true;
-    audio_pause = false;
+    std::lock_guard<std::mutex> lock(m_lock);
+    fse_synth_set_point(m_ctx, x, y);
+  }
+  void Pause() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    fse_synth_stop(m_ctx);
+  }
+  void SetJulia(double x, double y) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (x < 1e8) {
+      fse_set_julia(m_ctx, x, y);
+    } else {
+      fse_clear_julia(m_ctx);
+    }
+  }
+  void SetFractal(int type) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    fse_set_fractal(m_ctx, type);
+  }
+  void SetSustain(bool sustain) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    fse_set_sustain(m_ctx, sustain);
   }
 
   virtual bool onGetData(Chunk& data) override {
     //Setup the chunk info
     data.samples = m_samples;
     data.sampleCount = AUDIO_BUFF_SIZE;
-    memset(m_samples, 0, sizeof(m_samples));
-
-    //Check if audio needs to reset
-    if (audio_reset) {
-      m_audio_time = 0;
-      play_cx = (jx < 1e8 ? jx : play_nx);
-      play_cy = (jy < 1e8 ? jy : play_ny);
-      play_x = play_nx;
-      play_y = play_ny;
-      play_px = play_nx;
-      play_py = play_ny;
-      mean_x = play_nx;
-      mean_y = play_ny;
-      volume = 8000.0;
-      audio_reset = false;
-    }
 
-    //Check if paused
-    if (audio_pause) {
-      return true;
-    }
-
-    //Generate the tones
-    const int steps = sample_rate / max_freq;
-    for (int i = 0; i < AUDIO_BUFF_SIZE; i+=2) {
-      const int j = m_audio_time % steps;
-      if (j == 0) {
-        play_px = play_x;
-        play_py = play_y;
-        fractal(play_x, play_y, play_cx, play_cy);
-        if (play_x*play_x + play_y*play_y > escape_radius_sq) {
-          audio_pause = true;
-          return true;
-        }
-
-        if (normalized) {
-          dpx = play_px - play_cx;
-          dpy = play_py - play_cy;
-          dx = play_x - play_cx;
-          dy = play_y - play_cy;
-          if (dx != 0.0 || dy != 0.0) {
-            double dpmag = 1.0 / std::sqrt(1e-12 + dpx*dpx + dpy*dpy);
-            double dmag = 1.0 / std::sqrt(1e-12 + dx*dx + dy*dy);
-            dpx *= dpmag;
-            dpy *= dpmag;
-            dx *= dmag;
-            dy *= dmag;
-          }
-        } else {
-          //Point is relative to mean
-          dx = play_x - mean_x;
-          dy = play_y - mean_y;
-          dpx = play_px - mean_x;
-          dpy = play_py - mean_y;
-        }
-
-        //Update mean
-        mean_x = mean_x*0.99 + play_x*0.01;
-        mean_y = mean_y*0.99 + play_y*0.01;
-
-        //Don't let the volume go to infinity, clamp.
-        double m = dx*dx + dy*dy;
-        if (m > 2.0) {
-          dx *= 2.0 / m;
-          dy *= 2.0 / m;
-        }
-        m = dpx*dpx + dpy*dpy;
-        if (m > 2.0) {
-          dpx *= 2.0 / m;
-          dpy *= 2.0 / m;
-        }
-
-        //Lose volume over time unless in sustain mode
-        if (!sustain) {
-          volume *= 0.9992;
-        }
-      }
-
-      //Cosine interpolation
-      double t = double(j) / double(steps);
-      t = 0.5 - 0.5*std::cos(t * 3.14159);
-      double wx = t*dx + (1.0 - t)*dpx;
-      double wy = t*dy + (1.0 - t)*dpy;
-
-      //Save the audio to the 2 channels
-      m_samples[i]   = (int16_t)std::min(std::max(wx * volume, -32000.0), 32000.0);
-      m_samples[i+1] = (int16_t)std::min(std::max(wy * volume, -32000.0), 32000.0);
-      m_audio_time += 1;
-    }
-
-    //Return the sound clip
-    return !audio_reset;
+    //Generate the tones straight into the chunk
+    std::lock_guard<std::mutex> lock(m_lock);
+    fse_synth_generate(m_ctx, m_samples, AUDIO_BUFF_SIZE / 2);
+    return true;
   }
 
+protected:
+  fse_context* m_ctx;
+  std::mutex m_lock;
   int16_t m_samples[AUDIO_BUFF_SIZE];
-  int32_t m_audio_time;
-  double mean_x;
-  double mean_y;
-  double dx;
-  double dy;
-  double dpx;
-  double dpy;
 };
 
 //Change the fractal
@@ -270,21 +142,125 @@ void SetFractal(sf::Shader& shader, int type, Synth& synth) {
   shader.setUniform("iType", type);
   jx = jy = 1e8;
   fractal = all_fractals[type];
+  fractal_type = type;
   normalized = (type == 0);
-  synth.audio_pause = true;
+  density_mode = (type < 4 ? DENSITY_ESCAPING : DENSITY_ALL);
+  synth.SetFractal(type);
   hide_orbit = true;
+  show_spectrum = false;
   frame = 0;
 }
 
+//Spectrum map being computed in the background
+struct SpectrumJob {
+  SpectrumParams params;
+  std::vector<float> values;
+  std::atomic<bool> done;
+};
+
+//Start analyzing the orbit audio of every point in the current view
+std::shared_ptr<SpectrumJob> StartSpectrumMap() {
+  std::shared_ptr<SpectrumJob> job = std::make_shared<SpectrumJob>();
+  SpectrumParams& params = job->params;
+  const int longest = std::max(window_w, window_h);
+  const int w = std::max(window_w * spectrum_res / longest, 1);
+  const int h = std::max(window_h * spectrum_res / longest, 1);
+  params.fractal = fractal;
+  params.metric = spectrum_metric;
+  params.normalized = normalized;
+  params.sustain = sustain;
+  params.jx = jx;
+  params.jy = jy;
+  ScreenToPt(0, 0, params.x0, params.y0);
+  params.step_x = double(window_w) / double(w) / cam_zoom;
+  params.step_y = double(window_h) / double(h) / cam_zoom;
+  params.width = w;
+  params.height = h;
+  params.sample_rate = sample_rate;
+  params.max_freq = max_freq;
+  params.fft_size = spectrum_fft_size;
+  params.num_threads = 0;
+  job->values.resize(w * h);
+  job->done = false;
+
+  //The job owns everything it touches, so it can outlive a newer request
+  std::thread([job]() {
+    ComputeOrbitSpectrum(job->params, job->values.data());
+    job->done = true;
+  }).detach();
+  return job;
+}
+
+//Restart the orbit density render for the current view
+void ResetDensity(OrbitDensity& density, sf::Texture& texture) {
+  DensityParams params;
+  params.fractal = fractal;
+  params.mode = density_mode;
+  params.jx = jx;
+  params.jy = jy;
+  ScreenToPt(0, 0, params.x0, params.y0);
+  params.step_x = 1.0 / cam_zoom;
+  params.step_y = 1.0 / cam_zoom;
+  params.width = window_w;
+  params.height = window_h;
+  if (density_mode == DENSITY_ESCAPING) {
+    //Escaping orbits can pass through the view from anywhere in the set
+    params.sample_x0 = -density_sample_radius;
+    params.sample_y0 = -density_sample_radius;
+    params.sample_x1 = density_sample_radius;
+    params.sample_y1 = density_sample_radius;
+  } else {
+    //Attractors start from the points on screen, like clicking them
+    ScreenToPt(0, 0, params.sample_x0, params.sample_y0);
+    ScreenToPt(window_w, window_h, params.sample_x1, params.sample_y1);
+  }
+  params.max_iters = max_iters;
+  params.skip_iters = density_skip_iters;
+  params.num_threads = 0;
+  params.seed = 1;
+  density.Reset(params);
+  if (texture.getSize() != sf::Vector2u(window_w, window_h)) {
+    texture.create(window_w, window_h);
+  }
+}
+
+//Render a grid of Julia sets for the parameters in the current view.
+//Each tile row is rendered and encoded as one strip on the export workers.
+void SaveJuliaAtlas(ExportQueue& exporter) {
+  AtlasParams params;
+  params.type = fractal_type;
+  ScreenToPt(0, 0, params.c_x0, params.c_y0);
+  ScreenToPt(window_w, window_h, params.c_x1, params.c_y1);
+  params.cols = atlas_cols;
+  params.rows = std::max(atlas_cols * window_h / window_w, 1);
+  params.tile_size = atlas_tile_size;
+  params.view_radius = atlas_view_radius;
+  params.max_iters = atlas_max_iters;
+  params.use_color = use_color;
+  params.num_threads = 1;  //The export workers already run strips in parallel
+
+  const time_t t = std::time(0);
+  const tm* now = std::localtime(&t);
+  char buffer[128];
+  std::strftime(buffer, sizeof(buffer), "atlas_%m-%d-%y_%H-%M-%S.png", now);
+  exporter.SavePng(buffer, AtlasWidth(params), AtlasHeight(params), params.tile_size,
+    [params](uint8_t* rgba, int row_begin, int row_end) {
+      RenderJuliaAtlas(params, rgba, AtlasWidth(params) * 4, row_begin / params.tile_size, row_end / params.tile_size);
+    });
+}
+
 //Used whenever the window is created or resized
-void resize_window(sf::RenderWindow& window, sf::RenderTexture& rt, const sf::ContextSettings& settings, int w, int h) {
+void resize_window(sf::RenderWindow& window, sf::RenderTexture* rts, const sf::ContextSettings& settings, int w, int h) {
   window_w = w;
   window_h = h;
-  rt.create(w, h);
+  for (int i = 0; i < DynamicResolution::NUM_LEVELS; ++i) {
+    rts[i].create(std::max(w >> i, 1), std::max(h >> i, 1));
+    rts[i].setSmooth(i > 0);
+  }
   window.setView(sf::View(sf::FloatRect(0, 0, (float)w, (float)h)));
   frame = 0;
 }
-void make_window(sf::RenderWindow& window, sf::RenderTexture& rt, const sf::ContextSettings& settings, bool is_fullscreen) {
+void make_window(sf::RenderWindow& window, sf::RenderTexture* rts, const sf::ContextSettings& settings, bool is_fullscreen) {
   window.close();
   sf::VideoMode screenSize;
   if (is_fullscreen) {
@@ -294,7 +270,7 @@ void make_window(sf::RenderWindow& window, sf::RenderTexture& rt, const sf::Cont
     screenSize = sf::VideoMode(window_w_init, window_h_init, 24);
     window.create(screenSize, window_name, sf::Style::Resize | sf::Style::Close, settings);
   }
-  resize_window(window, rt, settings, screenSize.width, screenSize.height);
+  resize_window(window, rts, settings, screenSize.width, screenSize.height);
   window.setFramerateLimit(target_fps);
   //window.setVerticalSyncEnabled(true);
   window.setKeyRepeatEnabled(false);
@@ -350,10 +326,10 @@ int main(int argc, char *argv[]) {
 
   //Create the window
   sf::RenderWindow window;
-  sf::RenderTexture renderTexture;
+  sf::RenderTexture renderTextures[DynamicResolution::NUM_LEVELS];
   bool is_fullscreen = false;
   bool toggle_fullscreen = false;
-  make_window(window, renderTexture, settings, is_fullscreen);
+  make_window(window, renderTextures, settings, is_fullscreen);
 
   //Create audio synth
   Synth synth(window.getSystemHandle());
@@ -366,6 +342,24 @@ int main(int argc, char *argv[]) {
   //Start the synth
   synth.play();
 
+  //Snapshots are encoded and written in the background
+  ExportQueue exporter;
+
+  //Render quality controller and the frame its quality last changed on
+  DynamicResolution quality(target_fps, max_iters);
+  int quality_frame = 0;
+
+  //Orbit spectrum overlay, the view it was computed for and the next one
+  sf::Texture spectrumTexture;
+  SpectrumParams spectrumParams;
+  bool spectrumReady = false;
+  std::shared_ptr<SpectrumJob> spectrumJob;
+
+  //Orbit density renderer, refined a little every frame
+  OrbitDensity density;
+  sf::Texture densityTexture;
+  std::vector<uint8_t> densityPixels;
+
   //Main Loop
   double px, py, orbit_x, orbit_y;
   bool leftPressed = false;
@@ -373,19 +367,20 @@ int main(int argc, char *argv[]) {
   bool juliaDrag = false;
   bool takeScreenshot = false;
   bool showHelpMenu = false;
+  bool quitting = false;
   sf::Vector2i prevDrag;
   while (window.isOpen()) {
     sf::Event event;
     while (window.pollEvent(event)) {
       if (event.type == sf::Event::Closed) {
-        window.close();
+        quitting = true;
         break;
       } else if (event.type == sf::Event::Resized) {
-        resize_window(window, renderTexture, settings, event.size.width, event.size.height);
+        resize_window(window, renderTextures, settings, event.size.width, event.size.height);
       } else if (event.type == sf::Event::KeyPressed) {
         const sf::Keyboard::Key keycode = event.key.code;
         if (keycode == sf::Keyboard::Escape) {
-          window.close();
+          quitting = true;
           break;
         } else if (keycode >= sf::Keyboard::Num1 && keycode <= sf::Keyboard::Num8) {
           SetFractal(shader, keycode - sf::Keyboard::Num1, synth);
@@ -393,6 +388,7 @@ int main(int argc, char *argv[]) {
           toggle_fullscreen = true;
         } else if (keycode == sf::Keyboard::D) {
           sustain = !sustain;
+          synth.SetSustain(sustain);
         } else if (keycode == sf::Keyboard::C) {
           use_color = !use_color;
           frame = 0;
@@ -409,11 +405,33 @@ int main(int argc, char *argv[]) {
             const sf::Vector2i mousePos = sf::Mouse::getPosition(window);
             ScreenToPt(mousePos.x, mousePos.y, jx, jy);
           }
-          synth.audio_pause = true;
+          synth.SetJulia(jx, jy);
+          synth.Pause();
           hide_orbit = true;
+          show_spectrum = false;
           frame = 0;
         } else if (keycode == sf::Keyboard::S) {
           takeScreenshot = true;
+        } else if (keycode == sf::Keyboard::G) {
+          //Only the parameter plane has c values to build an atlas from
+          if (jx >= 1e8) {
+            SaveJuliaAtlas(exporter);
+          }
+        } else if (keycode == sf::Keyboard::B) {
+          show_density = !show_density;
+          frame = 0;
+        } else if (keycode == sf::Keyboard::A) {
+          if (!show_spectrum) {
+            spectrum_metric = SPECTRUM_DOMINANT;
+            show_spectrum = true;
+          } else {
+            spectrum_metric = SpectrumMetric(spectrum_metric + 1);
+            show_spectrum = (spectrum_metric != SPECTRUM_NUM_METRICS);
+          }
+          spectrumReady = false;
+          if (show_spectrum) {
+            spectrumJob = StartSpectrumMap();
+          }
         } else if (keycode == sf::Keyboard::H) {
           showHelpMenu = !showHelpMenu;
         }
@@ -439,7 +457,7 @@ int main(int argc, char *argv[]) {
           prevDrag = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
           dragging = true;
         } else if (event.mouseButton.button == sf::Mouse::Right) {
-          synth.audio_pause = true;
+          synth.Pause();
           hide_orbit = true;
         }
       } else if (event.type == sf::Event::MouseButtonReleased) {
@@ -464,11 +482,22 @@ int main(int argc, char *argv[]) {
         }
         if (juliaDrag) {
           ScreenToPt(event.mouseMove.x, event.mouseMove.y, jx, jy);
+          synth.SetJulia(jx, jy);
           frame = 0;
         }
       }
     }
 
+    //Keep the window open until every export is written
+    if (quitting) {
+      if (exporter.Pending() == 0) {
+        window.close();
+        break;
+      }
+      synth.Pause();
+      window.setTitle(std::string(window_name) + " - Saving...");
+    }
+
     //Apply zoom
     double fpx, fpy, delta_cam_x, delta_cam_y;
     ScreenToPt(cam_x_fp, cam_y_fp, fpx, fpy);
@@ -487,29 +516,99 @@ int main(int argc, char *argv[]) {
     const bool drawJset = (juliaDrag || hasJulia);
     const int flags = (drawMset ? 0x01 : 0) | (drawJset ? 0x02 : 0) | (use_color ? 0x04 : 0);
 
+    //Pick the render texture for the current quality level
+    sf::RenderTexture& renderTexture = renderTextures[quality.Level()];
+    const sf::Vector2u render_size = renderTexture.getSize();
+    const sf::Glsl::Vec2 render_res((float)render_size.x, (float)render_size.y);
+    const double render_scale = double(render_size.x) / double(window_w);
+
     //Set the shader parameters
-    const sf::Glsl::Vec2 window_res((float)window_w, (float)window_h);
-    shader.setUniform("iResolution", window_res);
+    shader.setUniform("iResolution", render_res);
     shader.setUniform("iCam", sf::Vector2f((float)cam_x, (float)cam_y));
-    shader.setUniform("iZoom", (float)cam_zoom);
+    shader.setUniform("iZoom", (float)(cam_zoom * render_scale));
     shader.setUniform("iFlags", flags);
     shader.setUniform("iJulia", sf::Vector2f((float)jx, (float)jy));
-    shader.setUniform("iIters", max_iters);
-    shader.setUniform("iTime", frame);
+    shader.setUniform("iIters", quality.Iters());
+
+    //Blending restarts whenever the view or the quality changed, so the
+    //running average only counts frames rendered at the current quality.
+    if (quality.Changed()) {
+      quality_frame = frame;
+    } else if (frame < quality_frame) {
+      quality_frame = 0;
+    }
+    const int blend_frame = frame - quality_frame;
+    shader.setUniform("iTime", blend_frame);
 
     //Draw the full-screen shader to the render texture
     sf::RenderStates states = sf::RenderStates::Default;
-    states.blendMode = (frame > 0 ? BlendAlpha : BlendIgnoreAlpha);
+    states.blendMode = (blend_frame > 0 ? BlendAlpha : BlendIgnoreAlpha);
     states.shader = &shader;
-    rect.setSize(window_res);
+    rect.setSize(render_res);
+    sf::Clock renderClock;
     renderTexture.draw(rect, states);
     renderTexture.display();
 
+    //Adjust quality for the next frame to hold the frame budget while moving.
+    //Only then is the render timed, since waiting on the GPU stalls the pipeline.
+    const bool moving = (frame <= 1 || dragging || juliaDrag);
+    double render_time = 0.0;
+    if (moving) {
+      glFinish();
+      render_time = renderClock.getElapsedTime().asSeconds();
+    }
+    quality.Update(render_time, moving);
+
     //Draw the render texture to the window
     sf::Sprite sprite(renderTexture.getTexture());
+    sprite.setScale((float)window_w / render_res.x, (float)window_h / render_res.y);
     window.clear();
     window.draw(sprite, sf::RenderStates(BlendIgnoreAlpha));
 
+    //Restart the density while the view changes, otherwise refine it
+    if (show_density) {
+      if (frame <= 1) {
+        ResetDensity(density, densityTexture);
+      }
+      sf::Clock passClock;
+      densityPixels.resize(window_w * window_h * 4);
+      density.RunPass(density_samples, densityPixels.data(), use_color);
+      densityTexture.update(densityPixels.data());
+      const double passTime = passClock.getElapsedTime().asSeconds();
+
+      //Aim to spend about half of each frame on the density, including the
+      //conversion and upload which don't shrink with the sample count
+      const double budget = 0.5 / target_fps;
+      const double ratio = std::min(std::max(budget / std::max(passTime, 1e-4), 0.5), 2.0);
+      density_samples = std::max(int(density_samples * ratio), 1000);
+      window.draw(sf::Sprite(densityTexture), sf::RenderStates(BlendIgnoreAlpha));
+    }
+
+    //Pick up a finished spectrum map unless its settings are out of date
+    if (spectrumJob && spectrumJob->done) {
+      const SpectrumParams& params = spectrumJob->params;
+      if (show_spectrum && params.fractal == fractal && params.metric == spectrum_metric &&
+          params.jx == jx && params.jy == jy) {
+        std::vector<uint8_t> pixels(params.width * params.height * 4);
+        OrbitSpectrumToRGBA(params, spectrumJob->values.data(), pixels.data());
+        spectrumTexture.create(params.width, params.height);
+        spectrumTexture.update(pixels.data());
+        spectrumParams = params;
+        spectrumReady = true;
+      }
+      spectrumJob.reset();
+    }
+
+    //Draw the spectrum map where it was computed so it follows the camera
+    if (show_spectrum && spectrumReady) {
+      int sx, sy;
+      PtToScreen(spectrumParams.x0, spectrumParams.y0, sx, sy);
+      sf::Sprite spectrumSprite(spectrumTexture);
+      spectrumSprite.setPosition((float)sx, (float)sy);
+      spectrumSprite.setScale((float)(spectrumParams.step_x * cam_zoom), (float)(spectrumParams.step_y * cam_zoom));
+      window.draw(spectrumSprite, sf::RenderStates(BlendAlpha));
+    }
+
     //Save screen shot if needed
     if (takeScreenshot) {
       window.display();
@@ -521,7 +620,10 @@ int main(int argc, char *argv[]) {
       sf::Texture texture;
       texture.create(windowSize.x, windowSize.y);
       texture.update(window);
-      texture.copyToImage().saveToFile(buffer);
+      const sf::Image image = texture.copyToImage();
+      const sf::Uint8* pixels = image.getPixelsPtr();
+      std::vector<uint8_t> rgba(pixels, pixels + windowSize.x * windowSize.y * 4);
+      exporter.SavePng(buffer, windowSize.x, windowSize.y, std::move(rgba));
       takeScreenshot = false;
     }
 
@@ -566,6 +668,9 @@ int main(int argc, char *argv[]) {
         "  C - Toggle Color                   Right Mouse - Stop orbit and sound\n"
         "F11 - Toggle Fullscreen             Scroll Wheel - Zoom in and out\n"
         "  S - Save Snapshot\n"
+        "  A - Cycle Orbit Spectrum Map\n"
+        "  B - Toggle Orbit Density\n"
+        "  G - Save Julia Atlas of View\n"
         "  R - Reset View\n"
         "  J - Hold down, move mouse, and\n"
         "      release to make Julia sets.\n"
@@ -600,7 +705,7 @@ int main(int argc, char *argv[]) {
     if (toggle_fullscreen) {
       toggle_fullscreen = false;
       is_fullscreen = !is_fullscreen;
-      make_window(window, renderTexture, settings, is_fullscreen);
+      make_window(window, renderTextures, settings, is_fullscreen);
     }
   }
 
@@ -0,0 +1,88 @@
+#pragma once
+#include "Fractals.h"
+
+//Orbit waveform state shared by the synth and the offline analysis.
+//Each call to Step advances the orbit by one iteration, and Sample
+//cosine-interpolates between the previous and current iterate.
+struct Orbit {
+  double x, y;
+  double cx, cy;
+  double px, py;
+  double mean_x, mean_y;
+  double dx, dy;
+  double dpx, dpy;
+  double volume;
+
+  void Reset(double nx, double ny, double ncx, double ncy) {
+    x = nx;
+    y = ny;
+    cx = ncx;
+    cy = ncy;
+    px = nx;
+    py = ny;
+    mean_x = nx;
+    mean_y = ny;
+    dx = dy = 0.0;
+    dpx = dpy = 0.0;
+    volume = 8000.0;
+  }
+
+  //Returns false once the orbit escapes
+  bool Step(Fractal fractal, bool normalized, bool sustain) {
+    px = x;
+    py = y;
+    fractal(x, y, cx, cy);
+    if (x*x + y*y > escape_radius_sq) {
+      return false;
+    }
+
+    if (normalized) {
+      dpx = px - cx;
+      dpy = py - cy;
+      dx = x - cx;
+      dy = y - cy;
+      if (dx != 0.0 || dy != 0.0) {
+        double dpmag = 1.0 / std::sqrt(1e-12 + dpx*dpx + dpy*dpy);
+        double dmag = 1.0 / std::sqrt(1e-12 + dx*dx + dy*dy);
+        dpx *= dpmag;
+        dpy *= dpmag;
+        dx *= dmag;
+        dy *= dmag;
+      }
+    } else {
+      //Point is relative to mean
+      dx = x - mean_x;
+      dy = y - mean_y;
+      dpx = px - mean_x;
+      dpy = py - mean_y;
+    }
+
+    //Update mean
+    mean_x = mean_x*0.99 + x*0.01;
+    mean_y = mean_y*0.99 + y*0.01;
+
+    //Don't let the volume go to infinity, clamp.
+    double m = dx*dx + dy*dy;
+    if (m > 2.0) {
+      dx *= 2.0 / m;
+      dy *= 2.0 / m;
+    }
+    m = dpx*dpx + dpy*dpy;
+    if (m > 2.0) {
+      dpx *= 2.0 / m;
+      dpy *= 2.0 / m;
+    }
+
+    //Lose volume over time unless in sustain mode
+    if (!sustain) {
+      volume *= 0.9992;
+    }
+    return true;
+  }
+
+  //t is the already cosine-shaped blend factor in [0,1]
+  void Sample(double t, double& wx, double& wy) const {
+    wx = (t*dx + (1.0 - t)*dpx) * volume;
+    wy = (t*dy + (1.0 - t)*dpy) * volume;
+  }
+};
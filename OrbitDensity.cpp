@@ -0,0 +1,326 @@
+#include "OrbitDensity.h"
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <math.h>
+
+//Samples handed out to a worker at a time
+static const int chunk_size = 256;
+
+//Share of the samples that stay uniform so no cell is ever starved
+static const double uniform_share = 0.2;
+
+OrbitDensity::OrbitDensity() {
+  m_num_samples = 0;
+  m_pass = 0;
+  m_job = nullptr;
+  m_generation = 0;
+  m_busy = 0;
+  m_quit = false;
+
+  //Palettes indexed by the square root of the normalized density
+  for (int i = 0; i < PALETTE_SIZE; ++i) {
+    const double t = double(i) / double(PALETTE_SIZE - 1);
+    m_gray[i] = uint8_t(255.0 * t);
+    m_color[i][0] = uint8_t(255.0 * std::pow(t, 0.6));
+    m_color[i][1] = uint8_t(255.0 * t);
+    m_color[i][2] = uint8_t(255.0 * std::pow(t, 1.8));
+  }
+}
+
+OrbitDensity::~OrbitDensity() {
+  StopWorkers();
+}
+
+void OrbitDensity::Reset(const DensityParams& params) {
+  m_params = params;
+  m_num_samples = 0;
+  m_pass = 0;
+
+  //The first merge overwrites m_hist, so it only needs clearing on resize
+  const int num_pixels = params.width * params.height;
+  if (int(m_hist.size()) != num_pixels) {
+    m_hist.assign(num_pixels, 0.0);
+  }
+  m_cell_hits.assign(CELLS * CELLS, 0.0);
+  m_cell_samples.assign(CELLS * CELLS, 0.0);
+  m_cell_cdf.clear();
+  m_cell_weight.assign(CELLS * CELLS, 1.0);
+
+  const int num_threads = NumThreads();
+  if (int(m_threads.size()) != num_threads) {
+    StopWorkers();
+    m_threads.resize(num_threads);
+    StartWorkers(num_threads);
+  }
+
+  //Per-thread histograms are left zeroed by every merge
+  for (ThreadData& td : m_threads) {
+    if (int(td.hist.size()) != num_pixels) {
+      td.hist.assign(num_pixels, 0.0f);
+    }
+    td.cell_hits.assign(CELLS * CELLS, 0.0);
+    td.cell_samples.assign(CELLS * CELLS, 0.0);
+    td.orbit.resize(params.max_iters * 2);
+  }
+}
+
+int OrbitDensity::NumThreads() const {
+  if (m_params.num_threads > 0) {
+    return m_params.num_threads;
+  }
+  return std::max(int(std::thread::hardware_concurrency()), 1);
+}
+
+void OrbitDensity::StartWorkers(int num_threads) {
+  //New workers count jobs from 0, so nothing old looks pending to them
+  m_quit = false;
+  m_generation = 0;
+  for (int t = 1; t < num_threads; ++t) {
+    m_workers.emplace_back(&OrbitDensity::WorkerLoop, this, t);
+  }
+}
+
+void OrbitDensity::StopWorkers() {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_start_cv.notify_all();
+  for (std::thread& t : m_workers) {
+    t.join();
+  }
+  m_workers.clear();
+}
+
+void OrbitDensity::WorkerLoop(int index) {
+  uint64_t seen = 0;
+  for (;;) {
+    const std::function<void(int)>* job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_start_cv.wait(lock, [&]() { return m_quit || m_generation != seen; });
+      if (m_quit) {
+        return;
+      }
+      seen = m_generation;
+      job = m_job;
+    }
+    (*job)(index);
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_busy -= 1;
+    }
+    m_done_cv.notify_one();
+  }
+}
+
+void OrbitDensity::RunParallel(const std::function<void(int)>& job) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job = &job;
+    m_busy = int(m_workers.size());
+    m_generation += 1;
+  }
+  m_start_cv.notify_all();
+  job(0);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done_cv.wait(lock, [this]() { return m_busy == 0; });
+  m_job = nullptr;
+}
+
+void OrbitDensity::RunPass(int num_samples, uint8_t* rgba, bool use_color) {
+  if (m_threads.empty() || num_samples <= 0) {
+    return;
+  }
+
+  //Splat into the per-thread histograms
+  const int num_chunks = (num_samples + chunk_size - 1) / chunk_size;
+  std::atomic<int> next_chunk(0);
+  RunParallel([&](int t) {
+    ThreadData& td = m_threads[t];
+    for (;;) {
+      const int chunk = next_chunk++;
+      if (chunk >= num_chunks) { break; }
+      const int count = std::min(chunk_size, num_samples - chunk * chunk_size);
+      const uint32_t seed = m_params.seed ^ (m_pass * 0x9E3779B9u) ^ (uint32_t(chunk) * 0x85EBCA6Bu);
+      SampleRange(td, seed, count);
+    }
+  });
+
+  //Merge by rows so every thread owns a disjoint part of the result,
+  //and find the maximum of those rows for the conversion.
+  const int num_threads = int(m_threads.size());
+  const int rows_per_thread = (m_params.height + num_threads - 1) / num_threads;
+  const bool first = (m_num_samples == 0);
+  RunParallel([&](int t) {
+    const int row_begin = std::min(t * rows_per_thread, m_params.height);
+    const int row_end = std::min(row_begin + rows_per_thread, m_params.height);
+    const int begin = row_begin * m_params.width;
+    const int end = row_end * m_params.width;
+    if (first) {
+      std::fill(m_hist.begin() + begin, m_hist.begin() + end, 0.0);
+    }
+    for (ThreadData& td : m_threads) {
+      for (int i = begin; i < end; ++i) {
+        m_hist[i] += td.hist[i];
+      }
+      std::fill(td.hist.begin() + begin, td.hist.begin() + end, 0.0f);
+    }
+    double max_val = 0.0;
+    for (int i = begin; i < end; ++i) {
+      max_val = std::max(max_val, m_hist[i]);
+    }
+    m_threads[t].max_val = max_val;
+  });
+
+  m_num_samples += num_samples;
+  m_pass += 1;
+  UpdateCells();
+
+  if (rgba == nullptr) {
+    return;
+  }
+  double max_val = 0.0;
+  for (const ThreadData& td : m_threads) {
+    max_val = std::max(max_val, td.max_val);
+  }
+  const double scale = (max_val > 0.0 ? 1.0 / max_val : 0.0);
+  RunParallel([&](int t) {
+    const int row_begin = std::min(t * rows_per_thread, m_params.height);
+    const int row_end = std::min(row_begin + rows_per_thread, m_params.height);
+    const int begin = row_begin * m_params.width;
+    const int end = row_end * m_params.width;
+    for (int i = begin; i < end; ++i) {
+      const int ix = std::min(int(std::sqrt(m_hist[i] * scale) * (PALETTE_SIZE - 1)), PALETTE_SIZE - 1);
+      uint8_t* px = rgba + size_t(i)*4;
+      if (use_color) {
+        px[0] = m_color[ix][0];
+        px[1] = m_color[ix][1];
+        px[2] = m_color[ix][2];
+      } else {
+        px[0] = px[1] = px[2] = m_gray[ix];
+      }
+      px[3] = 255;
+    }
+  });
+}
+
+void OrbitDensity::UpdateCells() {
+  const int num_cells = CELLS * CELLS;
+  for (ThreadData& td : m_threads) {
+    for (int i = 0; i < num_cells; ++i) {
+      m_cell_hits[i] += td.cell_hits[i];
+      m_cell_samples[i] += td.cell_samples[i];
+    }
+    std::fill(td.cell_hits.begin(), td.cell_hits.end(), 0.0);
+    std::fill(td.cell_samples.begin(), td.cell_samples.end(), 0.0);
+  }
+
+  //Estimate the mean contribution of each cell
+  double total_hits = 0.0;
+  double total_samples = 0.0;
+  for (int i = 0; i < num_cells; ++i) {
+    total_hits += m_cell_hits[i];
+    total_samples += m_cell_samples[i];
+  }
+  if (total_hits <= 0.0) {
+    return;
+  }
+  const double mean = total_hits / total_samples;
+  std::vector<double> pdf(num_cells);
+  double sum = 0.0;
+  for (int i = 0; i < num_cells; ++i) {
+    pdf[i] = (m_cell_samples[i] > 0.0 ? m_cell_hits[i] / m_cell_samples[i] : mean);
+    sum += pdf[i];
+  }
+
+  //Mix with uniform and convert to a cdf plus the inverse density weights
+  m_cell_cdf.resize(num_cells);
+  double acc = 0.0;
+  for (int i = 0; i < num_cells; ++i) {
+    const double p = (1.0 - uniform_share) * pdf[i] / sum + uniform_share / num_cells;
+    m_cell_weight[i] = 1.0 / (p * num_cells);
+    acc += p;
+    m_cell_cdf[i] = acc;
+  }
+  m_cell_cdf.back() = 1.0;
+}
+
+void OrbitDensity::SampleRange(ThreadData& td, uint32_t seed, int num_samples) {
+  const DensityParams& p = m_params;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const double cell_w = (p.sample_x1 - p.sample_x0) / CELLS;
+  const double cell_h = (p.sample_y1 - p.sample_y0) / CELLS;
+  const double inv_step_x = 1.0 / p.step_x;
+  const double inv_step_y = 1.0 / p.step_y;
+  const bool has_julia = (p.jx < 1e8);
+  float* hist = td.hist.data();
+  double* orbit = td.orbit.data();
+
+  for (int s = 0; s < num_samples; ++s) {
+    //Pick a cell by importance, then a point uniformly inside it
+    int cell;
+    if (m_cell_cdf.empty()) {
+      cell = std::min(int(uniform(rng) * CELLS * CELLS), CELLS * CELLS - 1);
+    } else {
+      cell = int(std::lower_bound(m_cell_cdf.begin(), m_cell_cdf.end(), uniform(rng)) - m_cell_cdf.begin());
+      cell = std::min(cell, CELLS * CELLS - 1);
+    }
+    const double sx = p.sample_x0 + ((cell % CELLS) + uniform(rng)) * cell_w;
+    const double sy = p.sample_y0 + ((cell / CELLS) + uniform(rng)) * cell_h;
+    const double cx = (has_julia ? p.jx : sx);
+    const double cy = (has_julia ? p.jy : sy);
+    const float weight = float(m_cell_weight[cell]);
+    double x = sx;
+    double y = sy;
+    int hits = 0;
+
+    if (p.mode == DENSITY_ESCAPING) {
+      //Record the orbit and only splat it if it escapes
+      int n = 0;
+      bool escaped = false;
+      for (; n < p.max_iters; ++n) {
+        p.fractal(x, y, cx, cy);
+        if (x*x + y*y > escape_radius_sq) {
+          escaped = true;
+          break;
+        }
+        orbit[n*2] = x;
+        orbit[n*2 + 1] = y;
+      }
+      if (escaped) {
+        for (int i = 0; i < n; ++i) {
+          const double fx = (orbit[i*2] - p.x0) * inv_step_x;
+          const double fy = (orbit[i*2 + 1] - p.y0) * inv_step_y;
+          if (fx >= 0.0 && fy >= 0.0 && fx < p.width && fy < p.height) {
+            hist[int(fy) * p.width + int(fx)] += weight;
+            hits += 1;
+          }
+        }
+      }
+    } else {
+      //Splat everything after the transient until it escapes
+      for (int i = 0; i < p.max_iters; ++i) {
+        p.fractal(x, y, cx, cy);
+        if (x*x + y*y > escape_radius_sq) {
+          break;
+        }
+        if (i < p.skip_iters) {
+          continue;
+        }
+        const double fx = (x - p.x0) * inv_step_x;
+        const double fy = (y - p.y0) * inv_step_y;
+        if (fx >= 0.0 && fy >= 0.0 && fx < p.width && fy < p.height) {
+          hist[int(fy) * p.width + int(fx)] += weight;
+          hits += 1;
+        }
+      }
+    }
+
+    td.cell_hits[cell] += hits;
+    td.cell_samples[cell] += 1.0;
+  }
+}
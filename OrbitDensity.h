@@ -0,0 +1,102 @@
+#pragma once
+#include "Fractals.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+//Which orbits get splatted into the histogram
+enum DensityMode {
+  DENSITY_ESCAPING,  //Only orbits that escape, for Buddhabrot-style images
+  DENSITY_ALL,       //Every orbit after a short transient, for attractor plots
+};
+
+//Histogram covers pixel (i,j) at (x0 + i*step_x, y0 + j*step_y).
+//Starting points are drawn from the sample box, and like a left click
+//each one is also the parameter unless a Julia parameter is set.
+struct DensityParams {
+  Fractal fractal;
+  DensityMode mode;
+  double jx, jy;
+  double x0, y0;
+  double step_x, step_y;
+  int width, height;
+  double sample_x0, sample_y0;
+  double sample_x1, sample_y1;
+  int max_iters;
+  int skip_iters;   //Transient iterations not splatted in DENSITY_ALL
+  int num_threads;  //0 uses all hardware threads
+  uint32_t seed;
+};
+
+//Progressive orbit density renderer.
+//Each thread splats into its own histogram during a pass, and the
+//histograms are merged in parallel by row afterwards so no two
+//threads ever write the same memory. Starting points are importance
+//sampled from a grid of cells weighted by how much they have
+//contributed so far, with each splat scaled by the inverse density.
+//The worker threads and buffers live as long as the renderer, so
+//restarting for a new view of the same size allocates nothing.
+class OrbitDensity {
+public:
+  static const int CELLS = 64;
+  static const int PALETTE_SIZE = 1024;
+
+  OrbitDensity();
+  ~OrbitDensity();
+
+  void Reset(const DensityParams& params);
+
+  //Splat num_samples more orbits. If rgba is not null the image is also
+  //converted to RGBA8 as part of the same parallel merge.
+  void RunPass(int num_samples, uint8_t* rgba, bool use_color);
+
+  const DensityParams& Params() const { return m_params; }
+  uint64_t NumSamples() const { return m_num_samples; }
+
+  //Only valid once NumSamples() > 0, Reset clears it lazily
+  const std::vector<double>& Histogram() const { return m_hist; }
+
+protected:
+  struct ThreadData {
+    std::vector<float> hist;
+    std::vector<double> cell_hits;
+    std::vector<double> cell_samples;
+    std::vector<double> orbit;
+    double max_val;
+  };
+
+  void SampleRange(ThreadData& td, uint32_t seed, int num_samples);
+  int NumThreads() const;
+  void UpdateCells();
+
+  //Run job(thread_index) on every thread including the caller
+  void RunParallel(const std::function<void(int)>& job);
+  void StartWorkers(int num_threads);
+  void StopWorkers();
+  void WorkerLoop(int index);
+
+  DensityParams m_params;
+  std::vector<ThreadData> m_threads;
+  std::vector<double> m_hist;
+  std::vector<double> m_cell_hits;
+  std::vector<double> m_cell_samples;
+  std::vector<double> m_cell_cdf;
+  std::vector<double> m_cell_weight;
+  uint8_t m_gray[PALETTE_SIZE];
+  uint8_t m_color[PALETTE_SIZE][3];
+  uint64_t m_num_samples;
+  uint32_t m_pass;
+
+  //Worker pool, thread t of m_threads runs on m_workers[t - 1]
+  std::vector<std::thread> m_workers;
+  const std::function<void(int)>* m_job;
+  uint64_t m_generation;
+  int m_busy;
+  bool m_quit;
+  std::mutex m_mutex;
+  std::condition_variable m_start_cv;
+  std::condition_variable m_done_cv;
+};
@@ -0,0 +1,243 @@
+#define _USE_MATH_DEFINES
+#include "OrbitSpectrum.h"
+#include "Orbit.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <math.h>
+
+//Tonality in dB that maps to the top of the palette
+static const double tonality_range_db = 40.0;
+
+//Precomputed tables shared read-only by all worker threads
+struct SpectrumPlan {
+  int n;
+  int steps;
+  std::vector<int> bitrev;
+  std::vector<double> tw_re;
+  std::vector<double> tw_im;
+  std::vector<double> window;
+  std::vector<double> interp;
+};
+
+static void BuildPlan(SpectrumPlan& plan, int n, int steps) {
+  plan.n = n;
+  plan.steps = steps;
+
+  //Bit reversal so samples are written pre-permuted for the FFT
+  int log2n = 0;
+  while ((1 << log2n) < n) { log2n += 1; }
+  plan.bitrev.resize(n);
+  for (int i = 0; i < n; ++i) {
+    int r = 0;
+    for (int b = 0; b < log2n; ++b) {
+      r |= ((i >> b) & 1) << (log2n - 1 - b);
+    }
+    plan.bitrev[i] = r;
+  }
+
+  //Forward transform twiddles
+  plan.tw_re.resize(n / 2);
+  plan.tw_im.resize(n / 2);
+  for (int k = 0; k < n / 2; ++k) {
+    plan.tw_re[k] = std::cos(2.0 * M_PI * k / n);
+    plan.tw_im[k] = -std::sin(2.0 * M_PI * k / n);
+  }
+
+  //Hann window to keep leakage from hiding weaker partials
+  plan.window.resize(n);
+  for (int i = 0; i < n; ++i) {
+    plan.window[i] = 0.5 - 0.5*std::cos(2.0 * M_PI * i / n);
+  }
+
+  //Same cosine interpolation the synth applies between iterations
+  plan.interp.resize(steps);
+  for (int j = 0; j < steps; ++j) {
+    const double t = double(j) / double(steps);
+    plan.interp[j] = 0.5 - 0.5*std::cos(t * 3.14159);
+  }
+}
+
+//Play each starting point into its lane as a complex signal (left + i*right).
+//Data is laid out as [sample][lane] so the FFT can vectorize across lanes.
+static void GenerateBatch(const SpectrumParams& params, const SpectrumPlan& plan,
+                          const double* sx, const double* sy, int count, double* re, double* im) {
+  const int n = plan.n;
+  std::fill(re, re + n*SPECTRUM_LANES, 0.0);
+  std::fill(im, im + n*SPECTRUM_LANES, 0.0);
+  for (int lane = 0; lane < count; ++lane) {
+    Orbit orbit;
+    orbit.Reset(sx[lane], sy[lane],
+                (params.jx < 1e8 ? params.jx : sx[lane]),
+                (params.jy < 1e8 ? params.jy : sy[lane]));
+    for (int i = 0; i < n; ++i) {
+      const int j = i % plan.steps;
+      if (j == 0 && !orbit.Step(params.fractal, params.normalized, params.sustain)) {
+        break;
+      }
+      double wx, wy;
+      orbit.Sample(plan.interp[j], wx, wy);
+      const int ix = plan.bitrev[i]*SPECTRUM_LANES + lane;
+      re[ix] = wx * plan.window[i];
+      im[ix] = wy * plan.window[i];
+    }
+  }
+}
+
+//In-place radix-2 FFT of all lanes at once, input already bit-reversed
+static void BatchFFT(const SpectrumPlan& plan, double* re, double* im) {
+  const int n = plan.n;
+  for (int len = 2; len <= n; len <<= 1) {
+    const int half = len / 2;
+    const int stride = n / len;
+    for (int i = 0; i < n; i += len) {
+      for (int k = 0; k < half; ++k) {
+        const double wr = plan.tw_re[k*stride];
+        const double wi = plan.tw_im[k*stride];
+        double* ar = re + (i + k)*SPECTRUM_LANES;
+        double* ai = im + (i + k)*SPECTRUM_LANES;
+        double* br = re + (i + k + half)*SPECTRUM_LANES;
+        double* bi = im + (i + k + half)*SPECTRUM_LANES;
+        for (int l = 0; l < SPECTRUM_LANES; ++l) {
+          const double tr = br[l]*wr - bi[l]*wi;
+          const double ti = br[l]*wi + bi[l]*wr;
+          br[l] = ar[l] - tr;
+          bi[l] = ai[l] - ti;
+          ar[l] += tr;
+          ai[l] += ti;
+        }
+      }
+    }
+  }
+}
+
+//Reduce the spectra of all lanes to the requested metric.
+//Positive and negative frequencies are folded since the sign only
+//tells the direction the orbit rotates in. Bins 0 and 1 only hold the
+//offset of the orbit (smeared by the window) so they are skipped, and
+//bins above max_freq are skipped since the cosine interpolation leaves
+//almost nothing there.
+static void WriteMetrics(const SpectrumParams& params, const SpectrumPlan& plan,
+                         const double* re, const double* im, int count, float* out) {
+  const int n = plan.n;
+  const int first_bin = 2;
+  const double bin_hz = double(params.sample_rate) / double(n);
+  const int last_bin = std::min(std::max(int(params.max_freq / bin_hz), first_bin), n / 2);
+  const bool need_log = (params.metric == SPECTRUM_TONALITY);
+  double total[SPECTRUM_LANES] = {};
+  double weighted[SPECTRUM_LANES] = {};
+  double log_sum[SPECTRUM_LANES] = {};
+  double best[SPECTRUM_LANES] = {};
+  int best_k[SPECTRUM_LANES] = {};
+  for (int k = first_bin; k <= last_bin; ++k) {
+    const double* pr = re + k*SPECTRUM_LANES;
+    const double* pi = im + k*SPECTRUM_LANES;
+    const double* nr = re + (n - k)*SPECTRUM_LANES;
+    const double* ni = im + (n - k)*SPECTRUM_LANES;
+    const double mirror = (k < n / 2 ? 1.0 : 0.0);
+    for (int l = 0; l < SPECTRUM_LANES; ++l) {
+      const double p = pr[l]*pr[l] + pi[l]*pi[l] + mirror*(nr[l]*nr[l] + ni[l]*ni[l]);
+      total[l] += p;
+      weighted[l] += p * k;
+      if (need_log) {
+        log_sum[l] += std::log(p + 1e-30);
+      }
+      if (p > best[l]) {
+        best[l] = p;
+        best_k[l] = k;
+      }
+    }
+  }
+
+  const int num_bins = last_bin - first_bin + 1;
+  for (int l = 0; l < count; ++l) {
+    if (total[l] < 1e-9) {
+      out[l] = 0.0f;
+      continue;
+    }
+    switch (params.metric) {
+    case SPECTRUM_DOMINANT:
+      out[l] = float(best_k[l] * bin_hz);
+      break;
+    case SPECTRUM_CENTROID:
+      out[l] = float(weighted[l] / total[l] * bin_hz);
+      break;
+    default: {
+      //Flatness in dB, kept above 0 so white noise isn't mistaken for silence
+      const double log_flatness = log_sum[l] / num_bins - std::log(total[l] / num_bins);
+      out[l] = float(std::max(-10.0 * log_flatness / M_LN10, 1e-3));
+      break;
+    }
+    }
+  }
+}
+
+void ComputeOrbitSpectrum(const SpectrumParams& params, float* out) {
+  SpectrumPlan plan;
+  BuildPlan(plan, params.fft_size, std::max(params.sample_rate / params.max_freq, 1));
+
+  const int num_points = params.width * params.height;
+  const int num_batches = (num_points + SPECTRUM_LANES - 1) / SPECTRUM_LANES;
+  std::atomic<int> next_batch(0);
+
+  //Each worker owns its buffers and pulls batches until none are left
+  auto worker = [&]() {
+    std::vector<double> re(plan.n * SPECTRUM_LANES);
+    std::vector<double> im(plan.n * SPECTRUM_LANES);
+    double sx[SPECTRUM_LANES];
+    double sy[SPECTRUM_LANES];
+    for (;;) {
+      const int batch = next_batch++;
+      if (batch >= num_batches) { break; }
+      const int start = batch * SPECTRUM_LANES;
+      const int count = std::min(SPECTRUM_LANES, num_points - start);
+      for (int l = 0; l < count; ++l) {
+        const int ix = start + l;
+        sx[l] = params.x0 + (ix % params.width) * params.step_x;
+        sy[l] = params.y0 + (ix / params.width) * params.step_y;
+      }
+      GenerateBatch(params, plan, sx, sy, count, re.data(), im.data());
+      BatchFFT(plan, re.data(), im.data());
+      WriteMetrics(params, plan, re.data(), im.data(), count, out + start);
+    }
+  };
+
+  int num_threads = params.num_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(int(std::thread::hardware_concurrency()), 1);
+  }
+  num_threads = std::min(num_threads, std::max(num_batches, 1));
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& t : threads) {
+    t.join();
+  }
+}
+
+void OrbitSpectrumToRGBA(const SpectrumParams& params, const float* values, uint8_t* rgba) {
+  //Frequencies are shown on a log scale from the lowest bin up to max_freq
+  const double min_hz = double(params.sample_rate) / double(params.fft_size);
+  const double log_range = std::log(double(params.max_freq) / min_hz);
+  const int num_points = params.width * params.height;
+  for (int i = 0; i < num_points; ++i) {
+    uint8_t* px = rgba + i*4;
+    const double v = values[i];
+    if (v <= 0.0) {
+      px[0] = px[1] = px[2] = px[3] = 0;
+      continue;
+    }
+    double t = v / tonality_range_db;
+    if (params.metric != SPECTRUM_TONALITY) {
+      t = std::log(std::max(v, min_hz) / min_hz) / log_range;
+    }
+    t = std::min(std::max(t, 0.0), 1.0) * 0.8;
+    px[0] = uint8_t(255.0 * (0.5 + 0.5*std::cos(2.0 * M_PI * (t + 0.5))));
+    px[1] = uint8_t(255.0 * (0.5 + 0.5*std::cos(2.0 * M_PI * (t + 0.8))));
+    px[2] = uint8_t(255.0 * (0.5 + 0.5*std::cos(2.0 * M_PI * (t + 0.1))));
+    px[3] = 224;
+  }
+}
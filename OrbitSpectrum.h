@@ -0,0 +1,38 @@
+#pragma once
+#include "Fractals.h"
+#include <cstdint>
+
+//Per-point spectral statistic written to the map
+enum SpectrumMetric {
+  SPECTRUM_DOMINANT,  //Frequency of the strongest bin in Hz
+  SPECTRUM_CENTROID,  //Power-weighted mean frequency in Hz
+  SPECTRUM_TONALITY,  //Spectral flatness up to max_freq as positive dB, near 0 is noise
+  SPECTRUM_NUM_METRICS
+};
+
+//Description of the grid of starting points to analyze.
+//Point (i,j) is (x0 + i*step_x, y0 + j*step_y) and is played exactly
+//like a left click there, including the Julia parameter if one is set.
+struct SpectrumParams {
+  Fractal fractal;
+  SpectrumMetric metric;
+  bool normalized;
+  bool sustain;
+  double jx, jy;
+  double x0, y0;
+  double step_x, step_y;
+  int width, height;
+  int sample_rate;
+  int max_freq;
+  int fft_size;     //Must be a power of 2
+  int num_threads;  //0 uses all hardware threads
+};
+
+//Number of waveforms transformed together, one per SIMD lane
+static const int SPECTRUM_LANES = 8;
+
+//Fills out[width*height] with the requested metric. Silent points are 0.
+void ComputeOrbitSpectrum(const SpectrumParams& params, float* out);
+
+//Maps metric values to RGBA pixels for display, transparent where silent
+void OrbitSpectrumToRGBA(const SpectrumParams& params, const float* values, uint8_t* rgba);
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+//CPU version of the palette at the end of fractal() in frag.glsl.
+//iters is the number of steps before escaping, or max_iters if it never did,
+//and the sums are the orbit statistics accumulated by the shader.
+inline void ShadeRGBA(int iters, int max_iters, double sum_x, double sum_y, double sum_z, bool use_color, uint8_t* px) {
+  double col[3];
+  if (iters != max_iters) {
+    const double n1 = std::sin(iters * 0.1) * 0.5 + 0.5;
+    const double n2 = std::cos(iters * 0.1) * 0.5 + 0.5;
+    const double s = (use_color ? 0.15 : 1.0);
+    col[0] = n1 * s;
+    col[1] = n2 * s;
+    col[2] = s;
+  } else if (use_color) {
+    col[0] = std::sin(std::abs(sum_x / max_iters * 5.0)) * 0.45 + 0.5;
+    col[1] = std::sin(std::abs(sum_y / max_iters * 5.0)) * 0.45 + 0.5;
+    col[2] = std::sin(std::abs(sum_z / max_iters * 5.0)) * 0.45 + 0.5;
+  } else {
+    col[0] = col[1] = col[2] = 0.0;
+  }
+  px[0] = uint8_t(std::min(std::max(col[0], 0.0), 1.0) * 255.0);
+  px[1] = uint8_t(std::min(std::max(col[1], 0.0), 1.0) * 255.0);
+  px[2] = uint8_t(std::min(std::max(col[2], 0.0), 1.0) * 255.0);
+  px[3] = 255;
+}